@@ -0,0 +1,185 @@
+/**
+ * @file connection.cpp
+ * @author Roman Fulla <xfulla00>
+ *
+ * @brief Connection state machine class.
+ */
+
+#include "connection.h"
+#include "dc_client.h"
+#include "isaexception.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+/* Backoff constructor */
+Backoff::Backoff(ulong base, ulong cap) : base(base), cap(cap), attempt(0), rng(std::random_device{}()) {}
+
+/* Advances backoff */
+ulong Backoff::next() {
+    ulong ceiling = base << std::min(attempt, 16u);
+    ceiling = std::min(ceiling, cap);
+    if (attempt < 16) attempt++;
+
+    // Jitter keeps bots that lost the connection at once from reconnecting at once.
+    std::uniform_int_distribution<ulong> jitter(ceiling / 2, ceiling);
+    return jitter(rng);
+}
+
+/* Resets backoff */
+void Backoff::reset() {
+    attempt = 0;
+}
+
+/* Circuit breaker constructor */
+Circuit_Breaker::Circuit_Breaker(uint threshold, ulong cooldown)
+    : state(State::Closed), failures(0), threshold(threshold), cooldown(cooldown) {}
+
+/* Checks if the endpoint can be called */
+bool Circuit_Breaker::allow() {
+    if (state == State::Open) {
+        if (remaining() > 0) return false;
+        state = State::Half_open;  // Lets one trial call through.
+    }
+    return true;
+}
+
+/* Time until the open breaker lets a trial call through */
+ulong Circuit_Breaker::remaining() const {
+    if (state != State::Open) return 0;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - opened);
+    if (elapsed >= cooldown) return 0;
+    return (cooldown - elapsed).count();
+}
+
+/* Records successful call */
+void Circuit_Breaker::success() {
+    state = State::Closed;
+    failures = 0;
+}
+
+/* Records failed call */
+void Circuit_Breaker::failure() {
+    failures++;
+    if (state == State::Half_open || failures >= threshold) {
+        state = State::Open;
+        opened = std::chrono::steady_clock::now();
+    }
+}
+
+/* Connection constructor */
+Connection::Connection(const std::string& token)
+    : token(token), state(State::Disconnected), backoff(1000, 60000), err_cnt(0) {}
+
+/* Gets client, connects if disconnected */
+DC_Client *Connection::client() {
+    switch (state) {
+        case State::Connected:
+            return dc.get();
+        case State::Backing_off:
+            wait();
+            return client();
+        default:
+            break;
+    }
+
+    Circuit_Breaker &breaker = breakers["CONNECT discord.com:443"];
+    if (!breaker.allow()) throw ISAexception("Circuit breaker is open.", 300);
+
+    state = State::Connecting;
+    dc.reset(new DC_Client(token));
+    breaker.success();
+    state = State::Connected;
+
+    return dc.get();
+}
+
+/* Starts call of the endpoint */
+void Connection::begin(const std::string& endpoint) {
+    if (state == State::Backing_off) wait();
+
+    this->endpoint = endpoint;
+    if (!breakers[endpoint].allow()) throw ISAexception("Circuit breaker is open.", 300);
+}
+
+/* Finishes successful call of the current endpoint */
+void Connection::end() {
+    breakers[endpoint].success();
+    endpoint.clear();
+    backoff.reset();
+    err_cnt = 0;
+}
+
+/* Records failure and schedules the next attempt */
+bool Connection::recover(const ISAexception& e) {
+    Circuit_Breaker &connect = breakers["CONNECT discord.com:443"];
+    ulong delay = std::max(backoff.next(), e.delay);
+
+    switch (state) {
+        case State::Connecting:  // Handshake failed, the endpoint was not called.
+            connect.failure();
+            state = State::Disconnected;
+            break;
+        case State::Connected:
+            if (!endpoint.empty() && e.ret != 300) breakers[endpoint].failure();
+
+            /* Client errors and missing status line leave the stream in an unknown state */
+            if (e.ret <= 200) {
+                dc.reset();
+                state = State::Disconnected;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (e.ret == 300) {
+        delay = std::max(delay, connect.remaining());
+        if (!endpoint.empty()) delay = std::max(delay, breakers[endpoint].remaining());
+    }
+    endpoint.clear();
+
+    if (!transient(e.ret) && ++err_cnt == 3) return false;
+
+    state = State::Backing_off;
+    resume = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+    return true;
+}
+
+/* Waits until the backoff ends */
+void Connection::wait() {
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(resume - std::chrono::steady_clock::now());
+    if (remaining.count() > 0) usleep(remaining.count());
+
+    state = dc ? State::Connected : State::Disconnected;
+}
+
+/* Checks if error is expected to go away by retrying */
+bool Connection::transient(int code) {
+    switch (code) {
+        case 20:   // Connect
+        case 21:
+        case 30:   // Handshake
+        case 100:  // Read
+        case 101:
+        case 102:  // Framing
+        case 200:  // Wrong HTTP response
+        case 222:  // Too many requests
+        case 226:  // Server errors
+        case 227:
+        case 228:
+        case 229:
+        case 231:
+        case 240:  // Regex
+        case 300:  // Circuit breaker
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,251 @@
+/**
+ * @file connection.h
+ * @author Roman Fulla <xfulla00>
+ *
+ * @brief Connection state machine header.
+ */
+
+#ifndef ISABOT_CONNECTION_H
+#define ISABOT_CONNECTION_H
+
+#include "dc_client.h"
+#include "isaexception.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+/**
+ * @brief Backoff
+ * Exponential backoff with jitter.
+ */
+class Backoff {
+private:
+    /**
+     * @brief base
+     * Delay of the first attempt(ms).
+     */
+    ulong base;
+
+    /**
+     * @brief cap
+     * Maximum delay(ms).
+     */
+    ulong cap;
+
+    /**
+     * @brief attempt
+     * Number of consecutive failed attempts.
+     */
+    uint attempt;
+
+    /**
+     * @brief rng
+     * Jitter generator.
+     */
+    std::mt19937 rng;
+public:
+    /**
+     * @brief Backoff
+     * Constructor, creates backoff.
+     */
+    Backoff(ulong base, ulong cap);
+
+    /**
+     * @brief next
+     * Advances backoff.
+     * @return delay before the next attempt(ms)
+     */
+    ulong next();
+
+    /**
+     * @brief reset
+     * Resets backoff after a successful attempt.
+     */
+    void reset();
+};
+
+/**
+ * @brief Circuit_Breaker
+ * Stops calling an endpoint after repeated failures.
+ */
+class Circuit_Breaker {
+public:
+    /**
+     * @brief State
+     * State of the breaker.
+     */
+    enum class State { Closed, Open, Half_open };
+private:
+    /**
+     * @brief state
+     * Current state.
+     */
+    State state;
+
+    /**
+     * @brief failures
+     * Number of consecutive failures.
+     */
+    uint failures;
+
+    /**
+     * @brief threshold
+     * Number of consecutive failures that opens the breaker.
+     */
+    uint threshold;
+
+    /**
+     * @brief cooldown
+     * Time the breaker stays open.
+     */
+    std::chrono::milliseconds cooldown;
+
+    /**
+     * @brief opened
+     * Time the breaker was opened.
+     */
+    std::chrono::steady_clock::time_point opened;
+public:
+    /**
+     * @brief Circuit_Breaker
+     * Constructor, creates closed breaker.
+     */
+    Circuit_Breaker(uint threshold = 5, ulong cooldown = 30000);
+
+    /**
+     * @brief allow
+     * Checks if the endpoint can be called(open breaker turns half open after cooldown).
+     * @return flag if call is allowed
+     */
+    bool allow();
+
+    /**
+     * @brief remaining
+     * Time until the open breaker lets a trial call through.
+     * @return remaining cooldown(ms)
+     */
+    ulong remaining() const;
+
+    /**
+     * @brief success
+     * Records successful call.
+     */
+    void success();
+
+    /**
+     * @brief failure
+     * Records failed call.
+     */
+    void failure();
+};
+
+/**
+ * @brief Connection
+ * Connection state machine, (re)connects client to discord.com.
+ */
+class Connection {
+public:
+    /**
+     * @brief State
+     * State of the connection.
+     */
+    enum class State { Disconnected, Connecting, Connected, Backing_off };
+private:
+    /**
+     * @brief token
+     * Discord bot authentication token.
+     */
+    std::string token;
+
+    /**
+     * @brief dc
+     * Connected client(empty when disconnected).
+     */
+    std::unique_ptr<DC_Client> dc;
+
+    /**
+     * @brief state
+     * Current state.
+     */
+    State state;
+
+    /**
+     * @brief resume
+     * Time the backoff ends.
+     */
+    std::chrono::steady_clock::time_point resume;
+
+    /**
+     * @brief backoff
+     * Delay between recovery attempts.
+     */
+    Backoff backoff;
+
+    /**
+     * @brief breakers
+     * Circuit breakers of the endpoints.
+     */
+    std::map<std::string, Circuit_Breaker> breakers;
+
+    /**
+     * @brief endpoint
+     * Endpoint currently being called.
+     */
+    std::string endpoint;
+
+    /**
+     * @brief err_cnt
+     * Number of consecutive non-transient errors.
+     */
+    int err_cnt;
+
+    /**
+     * @brief transient
+     * Checks if error is expected to go away by retrying.
+     * @return flag if error is transient
+     */
+    static bool transient(int code);
+
+    /**
+     * @brief wait
+     * Waits until the backoff ends.
+     */
+    void wait();
+public:
+    /**
+     * @brief Connection
+     * Constructor, creates disconnected connection.
+     */
+    Connection(const std::string& token);
+
+    /**
+     * @brief client
+     * Gets client, waits out backoff and connects if disconnected.
+     * @return client
+     */
+    DC_Client *client();
+
+    /**
+     * @brief begin
+     * Starts call of the endpoint(after backoff), throws if its breaker is open.
+     */
+    void begin(const std::string& endpoint);
+
+    /**
+     * @brief end
+     * Finishes successful call of the current endpoint.
+     */
+    void end();
+
+    /**
+     * @brief recover
+     * Records failure, drops broken connection and schedules the next attempt.
+     * @return flag if program should try again
+     */
+    bool recover(const ISAexception& e);
+};
+
+#endif
@@ -8,7 +8,9 @@
 #include "dc_client.h"
 #include "isaexception.h"
 
+#include <algorithm>
 #include <exception>
+#include <functional>
 #include <openssl/bio.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
@@ -17,18 +19,35 @@
 #include <vector>
 
 /* Consturctor */
-DC_Client::DC_Client(const std::string& token) : token(token) {
+DC_Client::DC_Client(const std::string& token) : token(token), bio(nullptr), ctx(nullptr) {
     SSL_library_init();
 
+    try {
+        connect();
+    }
+    catch (ISAexception &e) {
+        // Destructor is not called for a client that failed to construct.
+        BIO_free_all(bio);
+        SSL_CTX_free(ctx);
+        throw;
+    }
+}
+
+/* Connects to discord.com */
+void DC_Client::connect() {
     ctx = SSL_CTX_new(TLSv1_2_client_method());
     if (SSL_CTX_set_default_verify_paths(ctx) != 1) throw ISAexception("Couldn't set up a trust store.", 10);
 
     auto connect_bio = BIO_new_connect("discord.com:443");
     if (connect_bio == nullptr) throw ISAexception("Error in BIO_new_connect.", 20);
-    if (BIO_do_connect(connect_bio) <= 0) throw ISAexception("Error in BIO_do_connect.", 21);
 
     bio = BIO_new_ssl(ctx, 1);
-    bio = BIO_push(bio, connect_bio);
+    if (bio == nullptr) {
+        BIO_free(connect_bio);
+        throw ISAexception("Error in BIO_new_ssl.", 20);
+    }
+    bio = BIO_push(bio, connect_bio);  // From now on freed with bio.
+    if (BIO_do_connect(connect_bio) <= 0) throw ISAexception("Error in BIO_do_connect.", 21);
 
     std::string hostname = "discord.com";
     SSL_set_tlsext_host_name(get_ssl(bio), hostname.data());
@@ -38,7 +57,9 @@ DC_Client::DC_Client(const std::string& token) : token(token) {
 
     X509 *cert = SSL_get_peer_certificate(get_ssl(bio));
     if (cert == nullptr) throw ISAexception("No certificate was presented by the server.", 41);
-    if (X509_check_host(cert, hostname.data(), hostname.size(), 0, nullptr) != 1) throw ISAexception("Hostnames are not matching.", 42);
+    int host_matches = X509_check_host(cert, hostname.data(), hostname.size(), 0, nullptr);
+    X509_free(cert);
+    if (host_matches != 1) throw ISAexception("Hostnames are not matching.", 42);
 }
 
 /* Destructor */
@@ -83,19 +104,32 @@ void DC_Client::send_post(const std::string& destination, const std::string& pay
 
 /* Receives message from discord.com */
 std::string DC_Client::receive(std::string* head) {
-    std::string headers = receive_part(bio);
-    char *end_of_headers = strstr(&headers[0], "\r\n\r\n");
-    while (end_of_headers == nullptr) {
+    *head = receive_head();
+
+    std::string body;
+    receive_body(*head, [&body](const std::string& part) { body += part; });
+    return body;
+}
+
+/* Receives head of the message from discord.com */
+std::string DC_Client::receive_head() {
+    std::string headers = buffered;
+    std::size_t end_of_headers = headers.find("\r\n\r\n");
+    while (end_of_headers == std::string::npos) {
         headers += receive_part(bio);
-        end_of_headers = strstr(&headers[0], "\r\n\r\n");
+        end_of_headers = headers.find("\r\n\r\n");
     }
 
-    std::string body = std::string(end_of_headers+4, &headers[headers.size()]);
-    headers.resize(end_of_headers + 2 - &headers[0]);
+    buffered = headers.substr(end_of_headers + 4);
+    headers.resize(end_of_headers + 2);
+    return headers;
+}
 
+/* Receives body of the message from discord.com */
+void DC_Client::receive_body(const std::string& head, const std::function<void(const std::string&)>& sink) {
     bool chunked = false;
     size_t content_length = 0;
-    for (const std::string& line : split_headers(headers)) {
+    for (const std::string& line : split_headers(head)) {
         if (const char *colon = strchr(line.c_str(), ':')) {
             auto header_name = std::string(&line[0], colon);
             if (header_name == "Transfer-Encoding" && std::string(colon+2) == "chunked") {
@@ -103,28 +137,49 @@ std::string DC_Client::receive(std::string* head) {
                 break;
             }
             else if (header_name == "Content-Length") {
-                content_length = std::stoul(colon+1);
+                content_length = parse_size(colon+1, 10);
                 break;
             }
         }
     }
 
-    if (chunked) {
-        while (true) {
-            auto part = receive_part(bio);
-            if (part == "0\r\n\r\n") break;
-            body += part;
-        }
+    if (!chunked) {
+        consume(content_length, sink);
+        return;
     }
-    else {
-        while (body.size() < content_length) {
-            body += receive_part(bio);
-        }
+
+    while (true) {
+        std::size_t end_of_line;
+        while ((end_of_line = buffered.find("\r\n")) == std::string::npos) buffered += receive_part(bio);
+        size_t chunk_size = parse_size(buffered.substr(0, end_of_line), 16);
+        buffered.erase(0, end_of_line + 2);
+
+        if (chunk_size == 0) break;
+        consume(chunk_size, sink);
+
+        while (buffered.size() < 2) buffered += receive_part(bio);
+        buffered.erase(0, 2);  // CRLF after chunk data
     }
 
-    // return headers + "\r\n" + body;
-    *head = headers;
-    return body;
+    /* Trailers end with an empty line */
+    while (true) {
+        std::size_t end_of_line;
+        while ((end_of_line = buffered.find("\r\n")) == std::string::npos) buffered += receive_part(bio);
+        buffered.erase(0, end_of_line + 2);
+        if (end_of_line == 0) break;
+    }
+}
+
+/* Passes next bytes of the body to the sink */
+void DC_Client::consume(size_t size, const std::function<void(const std::string&)>& sink) {
+    while (size > 0) {
+        if (buffered.empty()) buffered = receive_part(bio);
+
+        size_t len = std::min(size, buffered.size());
+        sink(buffered.substr(0, len));
+        buffered.erase(0, len);
+        size -= len;
+    }
 }
 
 /* Receives part of the message */
@@ -137,6 +192,17 @@ std::string DC_Client::receive_part(BIO *bio) {
     else throw ISAexception("Empty BIO_read.", 101);
 }
 
+/* Parses size from the message framing */
+size_t DC_Client::parse_size(const std::string& text, int base) {
+    try {
+        return std::stoul(text, nullptr, base);
+    }
+    catch (std::exception &e) {
+        // Garbage instead of a size means the stream is out of sync.
+        throw ISAexception("Wrong message framing.", 102);
+    }
+}
+
 /* Splits headers */
 std::vector<std::string> DC_Client::split_headers(const std::string& text) {
     std::vector<std::string> lines;
@@ -11,6 +11,7 @@
 #include "isaexception.h"
 
 #include <exception>
+#include <functional>
 #include <openssl/bio.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
@@ -42,6 +43,18 @@ private:
      */
     SSL_CTX *ctx;
 
+    /**
+     * @brief buffered
+     * Received bytes not yet consumed.
+     */
+    std::string buffered;
+
+    /**
+     * @brief connect
+     * Connects to discord.com and verifies its certificate.
+     */
+    void connect();
+
     /**
      * @brief get_ssl
      * Gets ssl from BIO.
@@ -56,6 +69,19 @@ private:
      */
     std::string receive_part(BIO *bio);
 
+    /**
+     * @brief consume
+     * Passes next bytes of the body to the sink.
+     */
+    void consume(size_t size, const std::function<void(const std::string&)>& sink);
+
+    /**
+     * @brief parse_size
+     * Parses Content-Length or chunk size.
+     * @return size
+     */
+    static size_t parse_size(const std::string& text, int base);
+
     /**
      * @brief split_headers
      * Splits headers.
@@ -93,6 +119,19 @@ public:
      * @return body of the message(head as a parameter)
      */
     std::string receive(std::string* head);
+
+    /**
+     * @brief receive_head
+     * Receives head of the message from discord.com.
+     * @return head of the message
+     */
+    std::string receive_head();
+
+    /**
+     * @brief receive_body
+     * Receives body of the message from discord.com, passes it to the sink as it arrives.
+     */
+    void receive_body(const std::string& head, const std::function<void(const std::string&)>& sink);
 };
 
 #endif
\ No newline at end of file
@@ -6,9 +6,13 @@
  */
 
 #include "isabot.h"
+#include "connection.h"
 #include "dc_client.h"
 #include "isaexception.h"
+#include "json_reader.h"
 
+#include <algorithm>
+#include <deque>
 #include <exception>
 #include <iostream>
 #include <regex>
@@ -21,26 +25,19 @@ int main(int argc, char *argv[]) {
     std::string token = argparse(argc, argv, &verbose, &help);
     if (help) out_help();
 
+    Connection conn(token);
+    Session session;
     while (true) {
         try {
-            isabot(token, verbose);
+            isabot(&conn, &session, verbose);
         }
         catch (ISAexception &e) {
-            int err_cnt = 0;
-            if (e.ret == 100 || e.ret == 101 || e.ret == 240) {
-                std::cerr << e.msg << "..retrying(potential data loss)" << std::endl;
-                continue;
-            }
-            else {
-                err_cnt++;
-                if (err_cnt == 3) {
-                    std::cerr << e.msg << " Fatal error." << std::endl;
-                    return e.ret;
-                }
-
-                std::cerr << e.msg << "..retrying(potential data loss)" << std::endl;
-                continue;
+            if (!conn.recover(e)) {
+                std::cerr << e.msg << " Fatal error." << std::endl;
+                return e.ret;
             }
+
+            std::cerr << e.msg << "..retrying" << std::endl;
         }
     }
 }
@@ -83,17 +80,36 @@ void out_help() {
 }
 
 /* Isabot program */
-void isabot(const std::string& token, bool verbose) {
-    DC_Client client(token);
-    ulong last_msg;
-    ulong bot = get_bot(&client);
-    std::vector<ulong> guilds = get_guilds(&client);
-    ulong channel = get_channel (&client, guilds, "isa-bot", last_msg);
+void isabot(Connection *conn, Session *session, bool verbose) {
+    if (session->bot == 0) {
+        conn->begin("GET /api/users/@me");
+        session->bot = get_bot(conn->client());
+        conn->end();
+    }
+    if (session->guilds.empty()) {
+        conn->begin("GET /api/users/@me/guilds");
+        session->guilds = get_guilds(conn->client());
+        conn->end();
+    }
+    if (session->channel == 0) {
+        conn->begin("GET /api/guilds/{guild}/channels");
+        session->channel = get_channel(conn->client(), session->guilds, "isa-bot", session->last_msg);
+        conn->end();
+    }
 
     while (true) {
-        usleep(1000000);
-        std::vector<std::pair<std::string, std::string>> messages = get_messages(&client, channel, bot, last_msg);
-        echo(&client, channel, messages, verbose);
+        if (session->pending.empty()) {
+            usleep(1000000);
+            conn->begin("GET /api/channels/{channel}/messages");
+            get_messages(conn->client(), session->channel, session->bot, session->last_msg, session->pending);
+            conn->end();
+        }
+
+        if (!session->pending.empty()) {
+            conn->begin("POST /api/channels/{channel}/messages");
+            echo(conn->client(), session->channel, session->pending, verbose);
+            conn->end();
+        }
     }
 }
 
@@ -122,15 +138,34 @@ bool check_head(const std::string& head) {
         case 405:
             throw ISAexception("Method not allowed HTTP response.", 225);
         case 429:
-            usleep(2000000);
-            return true;
+            throw ISAexception("Too many requests HTTP response.", 222, retry_after(head));
+        case 500:
+            throw ISAexception("Internal server error HTTP response.", 227);
         case 502:
             throw ISAexception("Gateway unavailable HTTP response.", 226);
+        case 503:
+            throw ISAexception("Service unavailable HTTP response.", 228, retry_after(head));
+        case 504:
+            throw ISAexception("Gateway timeout HTTP response.", 229);
         default:
+            if (code >= 500 && code < 600) throw ISAexception("Server error HTTP response.", 231, retry_after(head));
             throw ISAexception("Unexpected HTTP response.", 230);
     }
 }
 
+/* Gets delay requested by the Retry-After header */
+ulong retry_after(const std::string& head) {
+    std::string lower = head;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    std::size_t pos = lower.find("\r\nretry-after:");
+    if (pos == std::string::npos) return 0;
+
+    char *ptr;
+    double seconds = strtod(lower.data() + pos + 14, &ptr);
+    return seconds > 0 ? static_cast<ulong>(seconds * 1000) : 0;
+}
+
 /* Get parsed part from the string */
 std::string parse(const std::string& source, const std::string& pattern) {
     std::smatch match;
@@ -249,82 +284,100 @@ ulong get_channel(DC_Client *client, const std::vector<ulong> &guilds, const std
 }
 
 /* Gets messages from the given channel after the last message */
-std::vector<std::pair<std::string, std::string>> get_messages(DC_Client *client, ulong channel, ulong bot, ulong &last_msg) {
-    std::string head, body;
+void get_messages(DC_Client *client, ulong channel, ulong bot, ulong &last_msg, std::deque<std::pair<std::string, std::string>>& messages) {
+    std::string head;
     bool retry = false;
     do {
         client->send_get("/api/channels/" + std::to_string(channel) + "/messages?after=" + std::to_string(last_msg));
-        body = client->receive(&head);
-        retry = check_head(head);
-        if (body == "[]") retry = true;
+        head = client->receive_head();
+        if (head.find("HTTP/1.1 200") == std::string::npos) {
+            client->receive_body(head, [](const std::string&) {});  // Keeps the stream in sync.
+            retry = check_head(head);
+        }
+        else retry = false;
     } while (retry);
 
-    /* Updates last message */
-    std::string last_msg_str = parse(body, "\"id\": \"[0-9]+");
-    last_msg_str = last_msg_str.substr(7);
-    char *ptr;
-    last_msg = strtoul(last_msg_str.data(), &ptr, 10);
+    /* Page is committed only once it is fully received, newest message comes first */
+    std::deque<std::pair<std::string, std::string>> page;
+    ulong newest = last_msg;
+    size_t skipped = 0;
+    JSON_Array_Reader reader([&](const std::string& message) {
+        try {
+            std::string msg_id_str = parse(message, "\"id\": \"[0-9]+");
+            msg_id_str = msg_id_str.substr(7);
+            char *ptr;
+            newest = std::max(newest, strtoul(msg_id_str.data(), &ptr, 10));
 
-    std::vector<std::string> msg_vect;
-    while (true) {
-        std::size_t start = body.find("{");
-        if (start == std::string::npos) break;
-        std::size_t end = body.find("}, {");
-        if (end == std::string::npos) {
-            std::size_t end = body.find("}]");
-            if (end == std::string::npos) break;
+            std::pair<std::string, std::string> msg;
+            if (parse_message(message, bot, &msg)) page.push_front(msg);
         }
+        catch (ISAexception &e) {
+            // Rest of the body still has to be read.
+            std::cerr << e.msg << "..skipping message" << std::endl;
+            skipped++;
+        }
+    });
+    client->receive_body(head, [&reader](const std::string& part) { reader.feed(part); });
 
-        std::string message_str = body.substr(start + 1, end - start - 1);
-        msg_vect.push_back(message_str);
-        body.erase(start, end - start + 1);
-    }
-
-    std::vector<std::pair<std::string, std::string>> messages;
-    for (auto const& message : msg_vect) {
-        std::pair<std::string, std::string> msg;
+    /* Cursor that can't move would fetch the same page forever */
+    if (skipped > 0 && newest == last_msg) throw ISAexception("Regex has failed (again).", 240);
 
-        std::string user_id_str = parse(message, "\"author\": .\"id\": \"[0-9]+");
-        user_id_str = user_id_str.substr(18);
-        ulong user_id = strtoul(user_id_str.data(), &ptr, 10);
+    last_msg = newest;
+    messages.insert(messages.end(), page.begin(), page.end());
+}
 
-        /* Parsing own message */
-        if (user_id == bot) continue;
+/* Parses author and content of the message */
+bool parse_message(const std::string& message, ulong bot, std::pair<std::string, std::string> *msg) {
+    char *ptr;
+    std::string user_id_str = parse(message, "\"author\": .\"id\": \"[0-9]+");
+    user_id_str = user_id_str.substr(18);
+    ulong user_id = strtoul(user_id_str.data(), &ptr, 10);
 
-        std::string username = parse(message, "\"username\": \".*?\"");
-        username = username.substr(13);
-        username = username.substr(0, username.size() - 1);
-        msg.first = username;
+    /* Parsing own message */
+    if (user_id == bot) return false;
 
-        /* Parsing message of a different bot */
-        std::size_t is_bot = username.find("bot");
-        if (is_bot != std::string::npos) continue;
+    std::string username = parse(message, "\"username\": \".*?\"");
+    username = username.substr(13);
+    username = username.substr(0, username.size() - 1);
+    msg->first = username;
 
-        std::string content = parse(message, "\"content\": \".*?\", \"channel_id\": \"");
-        content = content.substr(12);
-        content = content.substr(0, content.size() - 18);
-        msg.second = content;
+    /* Parsing message of a different bot */
+    std::size_t is_bot = username.find("bot");
+    if (is_bot != std::string::npos) return false;
 
-        messages.push_back(msg);
-    }
+    std::string content = parse(message, "\"content\": \".*?\", \"channel_id\": \"");
+    content = content.substr(12);
+    content = content.substr(0, content.size() - 18);
+    msg->second = content;
 
-    std::reverse(messages.begin(),messages.end());
-    return messages;
+    return true;
 }
 
 /* Echoes the given messages */
-void echo(DC_Client *client, const ulong channel, const std::vector<std::pair<std::string, std::string>>& messages, bool verbose) {
-    for (auto const& msg_pair : messages) {
+void echo(DC_Client *client, const ulong channel, std::deque<std::pair<std::string, std::string>>& messages, bool verbose) {
+    while (!messages.empty()) {
+       const std::pair<std::string, std::string>& msg_pair = messages.front();
        std::string message = "echo: " + msg_pair.first + " - " + msg_pair.second;
 
        std::string head, body;
        bool retry = false;
-       do {
-           client->send_post("/api/channels/" + std::to_string(channel) +"/messages", message);
-           body = client->receive(&head);
-           retry = check_head(head);
-       } while (retry);
-
+       try {
+           do {
+               client->send_post("/api/channels/" + std::to_string(channel) +"/messages", message);
+               body = client->receive(&head);
+               retry = check_head(head);
+           } while (retry);
+       }
+       catch (ISAexception &e) {
+           /* Rejected message(e.g. too long) would be rejected again */
+           if (e.ret != 220 && e.ret != 225) throw;
+
+           std::cerr << e.msg << "..dropping message" << std::endl;
+           messages.pop_front();
+           continue;
+       }
+
+       messages.pop_front();
        if (verbose) std::cout << message << std::endl;
     }
 }
\ No newline at end of file
@@ -8,15 +8,53 @@
 #ifndef ISABOT_H
 #define ISABOT_H
 
+#include "connection.h"
 #include "dc_client.h"
 #include "isaexception.h"
 
+#include <deque>
 #include <exception>
 #include <iostream>
 #include <regex>
 #include <vector>
 #include <unistd.h>
 
+/**
+ * @brief Session
+ * State discovered by isabot, kept across reconnects.
+ */
+struct Session {
+    /**
+     * @brief bot
+     * Bot ID(0 until discovered).
+     */
+    ulong bot = 0;
+
+    /**
+     * @brief guilds
+     * IDs of guilds bot is a part of.
+     */
+    std::vector<ulong> guilds;
+
+    /**
+     * @brief channel
+     * Channel ID(0 until discovered).
+     */
+    ulong channel = 0;
+
+    /**
+     * @brief last_msg
+     * ID of the last fetched message.
+     */
+    ulong last_msg = 0;
+
+    /**
+     * @brief pending
+     * Fetched messages that were not echoed yet.
+     */
+    std::deque<std::pair<std::string, std::string>> pending;
+};
+
 /**
  * @brief argparse
  * Argument parser.
@@ -32,9 +70,9 @@ void out_help();
 
 /**
  * @brief isabot
- * Echoes user messages in the first isabot channel he finds.
+ * Echoes user messages in the first isabot channel he finds(resumes given session).
  */
-void isabot(const std::string& token, bool verbose);
+void isabot(Connection *conn, Session *session, bool verbose);
 
 /**
  * @brief check_head
@@ -43,6 +81,13 @@ void isabot(const std::string& token, bool verbose);
  */
 bool check_head(const std::string& head);
 
+/**
+ * @brief retry_after
+ * Gets delay requested by the Retry-After header of response.
+ * @return delay(ms), 0 if there is none
+ */
+ulong retry_after(const std::string& head);
+
 /**
  * @brief parse
  * Parses string according to given regex.
@@ -73,15 +118,21 @@ ulong get_channel(DC_Client *client, const std::vector<ulong> &guilds, const std
 
 /**
  * @brief get_messages
- * Gets messages from the given channel after the last message.
- * @return channel messages
+ * Gets messages from the given channel after the last message, parses each one as soon as it is received.
+ */
+void get_messages(DC_Client *client, ulong channel, ulong bot, ulong &last_msg, std::deque<std::pair<std::string, std::string>>& messages);
+
+/**
+ * @brief parse_message
+ * Parses author and content of the message.
+ * @return flag if the message should be echoed
  */
-std::vector<std::pair<std::string, std::string>> get_messages(DC_Client *client, ulong channel, ulong bot, ulong &last_msg);
+bool parse_message(const std::string& message, ulong bot, std::pair<std::string, std::string> *msg);
 
 /**
  * @brief echo
- * Echoes the given messages.
+ * Echoes the given messages, removes each one once it is echoed.
  */
-void echo(DC_Client *client, const ulong channel, const std::vector<std::pair<std::string, std::string>>& messages, bool verbose);
+void echo(DC_Client *client, const ulong channel, std::deque<std::pair<std::string, std::string>>& messages, bool verbose);
 
 #endif
\ No newline at end of file
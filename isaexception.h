@@ -19,7 +19,8 @@ class ISAexception : public std::exception {
 public:
     int ret;
     std::string msg;
-    ISAexception(const char *msg, int code) : ret(code), msg(msg) {}
+    unsigned long delay;  // Minimal delay before retrying(ms), requested by the server.
+    ISAexception(const char *msg, int code, unsigned long delay = 0) : ret(code), msg(msg), delay(delay) {}
 };
 
 #endif
@@ -0,0 +1,52 @@
+/**
+ * @file json_reader.cpp
+ * @author Roman Fulla <xfulla00>
+ *
+ * @brief Incremental JSON array reader class.
+ */
+
+#include "json_reader.h"
+
+#include <functional>
+#include <string>
+
+/* Constructor */
+JSON_Array_Reader::JSON_Array_Reader(const std::function<void(const std::string&)>& handler)
+    : handler(handler), depth(0), array(false), in_string(false), escaped(false) {}
+
+/* Reads next part of the array */
+void JSON_Array_Reader::feed(const std::string& part) {
+    for (char c : part) {
+        if (in_string) {
+            if (depth > 1) element += c;
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') in_string = false;
+            continue;
+        }
+
+        switch (c) {
+            case '"':
+                in_string = true;
+                break;
+            case '{':
+            case '[':
+                if (depth == 0) array = (c == '[');
+                depth++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                break;
+        }
+
+        /* Only objects and arrays are collected as elements */
+        if (!array || depth < 1) continue;
+        if (depth > 1) element += c;
+        else if (c == '}' || c == ']') {
+            element += c;
+            handler(element);
+            element.clear();
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file json_reader.h
+ * @author Roman Fulla <xfulla00>
+ *
+ * @brief Incremental JSON array reader header.
+ */
+
+#ifndef ISABOT_JSON_READER_H
+#define ISABOT_JSON_READER_H
+
+#include <functional>
+#include <string>
+
+/**
+ * @brief JSON_Array_Reader
+ * Splits JSON array into its elements as the array arrives in parts.
+ */
+class JSON_Array_Reader {
+private:
+    /**
+     * @brief handler
+     * Called with every complete element.
+     */
+    std::function<void(const std::string&)> handler;
+
+    /**
+     * @brief element
+     * Element read so far.
+     */
+    std::string element;
+
+    /**
+     * @brief depth
+     * Nesting depth(1 inside the array).
+     */
+    int depth;
+
+    /**
+     * @brief array
+     * Flag if the top-level value is an array.
+     */
+    bool array;
+
+    /**
+     * @brief in_string
+     * Flag if reader is inside a string.
+     */
+    bool in_string;
+
+    /**
+     * @brief escaped
+     * Flag if the previous character was an escape.
+     */
+    bool escaped;
+public:
+    /**
+     * @brief JSON_Array_Reader
+     * Constructor, creates reader.
+     */
+    JSON_Array_Reader(const std::function<void(const std::string&)>& handler);
+
+    /**
+     * @brief feed
+     * Reads next part of the array.
+     */
+    void feed(const std::string& part);
+};
+
+#endif